@@ -1,5 +1,6 @@
 #include "cvMeshBlurCmd.h"
 #include "cvMeshBlurDeformer.h"
+#include "cvMeshBlurRegistry.h"
 
 
 bool IsShapeNode(MDagPath& path) {
@@ -43,11 +44,25 @@ MStatus GetShapeNode(MDagPath& path, bool intermediate) {
     return MS::kFailure;
 }
 
+MString EscapeString(const MString& value) {
+    std::string escaped;
+    const char* chars = value.asChar();
+    for (unsigned int i = 0; i < value.length(); ++i) {
+        if (chars[i] == '"' || chars[i] == '\\') {
+            escaped += '\\';
+        }
+        escaped += chars[i];
+    }
+    return MString(escaped.c_str());
+}
+
 const char* cvMeshBlurCmd::kName = "cvMeshBlur";
 
 
 cvMeshBlurCmd::cvMeshBlurCmd()
-    : name_("cvMeshBlur#") {
+    : name_("cvMeshBlur#"),
+      shared_(false),
+      dedupeStats_(false) {
 }
 
 
@@ -55,7 +70,10 @@ MSyntax cvMeshBlurCmd::newSyntax()
 {
     MSyntax syntax;
     syntax.addFlag("-n", "-name", MSyntax::kString);
-    syntax.setObjectType(MSyntax::kSelectionList, 1, 1);
+    syntax.addFlag("-sh", "-shared");
+    syntax.addFlag("-ds", "-dedupeStats");
+    syntax.addFlag("-rs", "-resetStats");
+    syntax.setObjectType(MSyntax::kSelectionList, 0);
     syntax.useSelectionAsDefault(true);
     return syntax;
 }
@@ -66,12 +84,23 @@ void* cvMeshBlurCmd::creator()
 }
 
 bool cvMeshBlurCmd::isUndoable() const {
-    return true;
+    return !dedupeStats_;
 }
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
 Summary:
-    Creates an cvMeshBlur deformer based on the selection.
+    Creates cvMeshBlur deformers on all of the selected meshes. By default each
+    mesh gets its own deformer. With -shared, a single deformer drives all of
+    the meshes.
+
+    With -dedupeStats, nothing is created and the result is the shared
+    evaluation hit rate followed by the hit and lookup counts. With
+    -resetStats, those counts are cleared after they are returned.
+
+    The deformers are inserted into the deformation chains by one batched
+    deformer script. Their time and world matrix connections are then made with
+    a single MDGModifier on plugs found once. Both are undone together so the
+    whole operation is one undo step.
 Parameters:
     [in]    args    - MArgList for command.
 Returns:
@@ -81,37 +110,81 @@ MStatus cvMeshBlurCmd::doIt(const MArgList& args)
 {
     MStatus status;
     MArgDatabase argData(syntax(), args);
+
+    if (argData.isFlagSet("-ds") || argData.isFlagSet("-rs")) {
+        dedupeStats_ = true;
+        unsigned long long hits, lookups;
+        cvMeshBlurRegistry::GetStats(hits, lookups);
+        double hitRate = lookups > 0 ? (double)hits / (double)lookups : 0.0;
+        appendToResult(hitRate);
+        appendToResult((double)hits);
+        appendToResult((double)lookups);
+        if (argData.isFlagSet("-rs")) {
+            cvMeshBlurRegistry::ResetStats();
+        }
+        return MS::kSuccess;
+    }
+
     argData.getObjects(selectionList_);
+    if (selectionList_.length() == 0) {
+        MGlobal::displayError("No meshes specified.");
+        return MS::kFailure;
+    }
 
     if (argData.isFlagSet("-n")) {
         name_ = argData.flagArgumentString("-n", 0, &status);
         CHECK_MSTATUS_AND_RETURN_IT(status);
     }
+    shared_ = argData.isFlagSet("-sh");
 
-    status = GetGeometryPath();
+    status = GetGeometryPaths();
     CHECK_MSTATUS_AND_RETURN_IT(status);
-    
-    // Add the cvWrap creation command to the modifier.
-    MString command = "deformer -type cvMeshBlur -n \"" + name_ + "\"";
-    MFnDagNode fnNode(pathMesh_);
-    command += " " + fnNode.partialPathName();
+
+    // Only the chain insertion goes through the deformer command. Everything
+    // else is connected through the API in redoIt.
+    MString command;
+    MString name = EscapeString(name_);
+    if (shared_) {
+        command += "deformer -type cvMeshBlur -n \"" + name + "\"";
+        for (unsigned int i = 0; i < pathMeshes_.length(); ++i) {
+            command += " \"" + EscapeString(pathMeshes_[i].fullPathName()) + "\"";
+        }
+        command += ";";
+    } else {
+        for (unsigned int i = 0; i < pathMeshes_.length(); ++i) {
+            command += "deformer -type cvMeshBlur -n \"" + name + "\" \"" +
+                       EscapeString(pathMeshes_[i].fullPathName()) + "\";";
+        }
+    }
     status = dgMod_.commandToExecute(command);
     CHECK_MSTATUS_AND_RETURN_IT(status);
-    
+
     return redoIt();
 }
 
 
-MStatus cvMeshBlurCmd::GetGeometryPath() {
+MStatus cvMeshBlurCmd::GetGeometryPaths() {
     MStatus status;
-    // The driver is selected last
-    status = selectionList_.getDagPath(0, pathMesh_);
-    CHECK_MSTATUS_AND_RETURN_IT(status);
-    status = GetShapeNode(pathMesh_, false);
-    // The driver must be a mesh for this specific algorithm.
-    if (!pathMesh_.hasFn(MFn::kMesh)) {
-        MGlobal::displayError("cvMeshBlur only works on meshes.");
-        return MS::kFailure;
+    pathMeshes_.clear();
+    std::set<std::string> shapes;
+    MDagPath pathMesh;
+    for (unsigned int i = 0; i < selectionList_.length(); ++i) {
+        status = selectionList_.getDagPath(i, pathMesh);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        status = GetShapeNode(pathMesh, false);
+        // The geometry must be a mesh for this specific algorithm.
+        if (!pathMesh.hasFn(MFn::kMesh)) {
+            MGlobal::displayError("cvMeshBlur only works on meshes: " + pathMesh.partialPathName());
+            return MS::kFailure;
+        }
+        // A transform selected with its own shape, the same mesh selected twice or
+        // two instances of one shape all resolve to the same shape node.
+        MFnDagNode fnShape(pathMesh.node(), &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        if (!shapes.insert(fnShape.fullPathName().asChar()).second) {
+            continue;
+        }
+        pathMeshes_.append(pathMesh);
     }
 
     return MS::kSuccess;
@@ -124,80 +197,140 @@ MStatus cvMeshBlurCmd::redoIt() {
     status = dgMod_.doIt();
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
-    // Reacquire the path because on referenced geo, a new mesh is created (the ShapeDeformed).
-    status = GetGeometryPath();
-    CHECK_MSTATUS_AND_RETURN_IT(status);
-    // Get the created mesh blur deformer node.
-    status = GetLatestMeshBlurNode();
-    CHECK_MSTATUS_AND_RETURN_IT(status);
+    status = ConnectDeformers();
+    if (status != MS::kSuccess) {
+        // A failed command leaves no undo entry, so remove the deformers created above.
+        // ConnectDeformers has already reverted any connections it made.
+        connectMod_.reset();
+        dgMod_.undoIt();
+        return status;
+    }
+
+    return MS::kSuccess;
+}
 
-    MFnDependencyNode fnDeformerNode(oMeshBlurNode_, &status);
-    MPlug plugInTime = fnDeformerNode.findPlug("time", false, &status);
-    CHECK_MSTATUS_AND_RETURN_IT(status);
-    MPlug plugInMatrix = fnDeformerNode.findPlug("worldMatrix", false, &status);
-    CHECK_MSTATUS_AND_RETURN_IT(status);
 
-    MSelectionList list;
-    status = MGlobal::getSelectionListByName("time1", list);
+MStatus cvMeshBlurCmd::ConnectDeformers() {
+    MStatus status;
+
+    // Reacquire the paths because on referenced geo, a new mesh is created (the ShapeDeformed).
+    status = GetGeometryPaths();
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
     MObject oTime;
-    list.getDependNode(0, oTime);
+    status = GetTimeNode(oTime);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
     MFnDependencyNode fnTime(oTime, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
     MPlug plugOutTime = fnTime.findPlug("outTime", false, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
-    MDagPath pathTransform(pathMesh_);
-    pathMesh_.pop();
-    MFnDependencyNode fnTransform(pathTransform.node(), &status);
+    // The deformer nodes are recreated on every redo, so the connections are too.
+    connectMod_.reset(new MDGModifier);
+    clearResult();
+    MObject oMeshBlurNode;
+    unsigned int inputIndex;
+    for (unsigned int i = 0; i < pathMeshes_.length(); ++i) {
+        status = GetMeshBlurNode(pathMeshes_[i], oMeshBlurNode, inputIndex);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        MFnDependencyNode fnDeformerNode(oMeshBlurNode, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        if (i == 0 || !shared_) {
+            MPlug plugInTime = fnDeformerNode.findPlug(cvMeshBlur::aTime, false, &status);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+            status = connectMod_->connect(plugOutTime, plugInTime);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+            appendToResult(fnDeformerNode.name());
+        }
+
+        // A shared node gets one geometryWorldMatrix element per deformer input index.
+        MPlug plugInMatrix;
+        if (shared_) {
+            plugInMatrix = fnDeformerNode.findPlug(cvMeshBlur::aGeometryWorldMatrix, false, &status);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+            plugInMatrix = plugInMatrix.elementByLogicalIndex(inputIndex, &status);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+        } else {
+            plugInMatrix = fnDeformerNode.findPlug(cvMeshBlur::aWorldMatrix, false, &status);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+        }
+
+        MDagPath pathTransform(pathMeshes_[i]);
+        pathTransform.pop();
+        MFnDependencyNode fnTransform(pathTransform.node(), &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        MPlug plugOutWorldMatrix = fnTransform.findPlug("worldMatrix", false, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        plugOutWorldMatrix = plugOutWorldMatrix.elementByLogicalIndex(0, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        status = connectMod_->connect(plugOutWorldMatrix, plugInMatrix);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+    status = connectMod_->doIt();
+    if (status != MS::kSuccess) {
+        // Revert whatever connections were made before the failure.
+        connectMod_->undoIt();
+        return status;
+    }
+
+    return MS::kSuccess;
+}
+
+
+MStatus cvMeshBlurCmd::GetMeshBlurNode(const MDagPath& pathMesh, MObject& oMeshBlurNode,
+                                       unsigned int& inputIndex) {
+    MStatus status;
+
+    // A newly created deformer is the last one in the chain, so its outputGeometry
+    // is connected directly to the inMesh of the deformed shape.
+    MFnDagNode fnMesh(pathMesh, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
-    MPlug plugOutWorldMatrix = fnTransform.findPlug("worldMatrix", false, &status);
+    MPlug plugInMesh = fnMesh.findPlug("inMesh", false, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
-    plugOutWorldMatrix = plugOutWorldMatrix.elementByLogicalIndex(0, &status);
+    MPlugArray plugs;
+    plugInMesh.connectedTo(plugs, true, false, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
-
-    MDGModifier dgMod;
-    dgMod.connect(plugOutTime, plugInTime);
-    dgMod.connect(plugOutWorldMatrix, plugInMatrix);
-    status = dgMod.doIt();
+    if (plugs.length() == 0) {
+        return MS::kFailure;
+    }
+    oMeshBlurNode = plugs[0].node();
+    MFnDependencyNode fnNode(oMeshBlurNode, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
-
-    setResult(fnDeformerNode.name());
-    
+    if (fnNode.typeId() != cvMeshBlur::id || !plugs[0].isElement()) {
+        return MS::kFailure;
+    }
+    inputIndex = plugs[0].logicalIndex();
     return MS::kSuccess;
 }
 
 
-MStatus cvMeshBlurCmd::GetLatestMeshBlurNode() {
+MStatus cvMeshBlurCmd::GetTimeNode(MObject& oTime) {
     MStatus status;
-    MObject oMesh = pathMesh_.node();
-
-    // Since we use MDGModifier to execute the deformer command, we can't get
-    // the created deformer node, so we need to find it in the deformation chain.
-    MItDependencyGraph itDG(oMesh,
-        MFn::kGeometryFilt,
-        MItDependencyGraph::kUpstream,
-        MItDependencyGraph::kDepthFirst,
-        MItDependencyGraph::kNodeLevel,
-        &status);
+
+    // Use the scene's default time node rather than looking time1 up by name.
+    MItDependencyNodes itNode(MFn::kTime, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
-    MObject oDeformerNode;
-    for (; !itDG.isDone(); itDG.next()) {
-        oDeformerNode = itDG.currentItem();
-        MFnDependencyNode fnNode(oDeformerNode, &status);
+    for (; !itNode.isDone(); itNode.next()) {
+        MFnDependencyNode fnNode(itNode.thisNode(), &status);
         CHECK_MSTATUS_AND_RETURN_IT(status);
-        if (fnNode.typeId() == cvMeshBlur::id) {
-            oMeshBlurNode_ = oDeformerNode;
+        if (fnNode.isDefaultNode()) {
+            oTime = itNode.thisNode();
             return MS::kSuccess;
         }
     }
+    MGlobal::displayError("Unable to find the scene time node.");
     return MS::kFailure;
 }
 
 
 MStatus cvMeshBlurCmd::undoIt() {
     MStatus status;
+    if (connectMod_) {
+        status = connectMod_->undoIt();
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        connectMod_.reset();
+    }
     status = dgMod_.undoIt();
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
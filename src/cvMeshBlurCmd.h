@@ -5,6 +5,7 @@
 #include <maya/MDagPath.h>
 #include <maya/MDagPathArray.h>
 #include <maya/MPlug.h>
+#include <maya/MPlugArray.h>
 #include <maya/MString.h>
 #include <maya/MStringArray.h>
 #include <maya/MGlobal.h>
@@ -17,6 +18,7 @@
 
 #include <maya/MItGeometry.h>
 #include <maya/MItDependencyGraph.h>
+#include <maya/MItDependencyNodes.h>
 
 #include <maya/MFnDagNode.h>
 #include <maya/MFnDependencyNode.h>
@@ -27,6 +29,10 @@
 
 #include <maya/MPxCommand.h>
 
+#include <memory>
+#include <set>
+#include <string>
+
 
 class cvMeshBlurCmd : public MPxCommand
 {
@@ -43,14 +49,18 @@ public:
 
 
 private:
-    MStatus GetGeometryPath();
-    MStatus GetLatestMeshBlurNode();
+    MStatus GetGeometryPaths();
+    MStatus ConnectDeformers();
+    MStatus GetMeshBlurNode(const MDagPath& pathMesh, MObject& oMeshBlurNode, unsigned int& inputIndex);
+    MStatus GetTimeNode(MObject& oTime);
 
     MString name_;  /**< Name of cvMeshBlur node to create. */
+    bool shared_;  /**< Whether one cvMeshBlur node drives all of the geometry. */
+    bool dedupeStats_;  /**< Whether the command only reports or resets shared evaluation stats. */
     MSelectionList selectionList_;  /**< Selected command input nodes. */
-    MDagPath pathMesh_;
-    MObject oMeshBlurNode_;  /**< MObject to the cvMeshBlur node in focus. */
-    MDGModifier dgMod_;
+    MDagPathArray pathMeshes_;  /**< Paths to the meshes to deform. */
+    MDGModifier dgMod_;  /**< Runs the deformer command that inserts the deformers. */
+    std::unique_ptr<MDGModifier> connectMod_;  /**< Connects time and worldMatrix inputs. */
 
 };
 
@@ -1,5 +1,8 @@
 #include "cvMeshBlurDeformer.h"
 
+#include <algorithm>
+#include <cmath>
+
 MTypeId cvMeshBlur::id(0x00115812);
 MObject cvMeshBlur::aTime;
 MObject cvMeshBlur::aNormalOffset;
@@ -9,6 +12,12 @@ MObject cvMeshBlur::aSmearFrames;
 MObject cvMeshBlur::aMinSmearVelocity;
 MObject cvMeshBlur::aMaxSmearVelocity;
 MObject cvMeshBlur::aWorldMatrix;
+MObject cvMeshBlur::aGeometryWorldMatrix;
+MObject cvMeshBlur::aMaxCatchUpFrames;
+MObject cvMeshBlur::aCatchUpTolerance;
+MObject cvMeshBlur::aShareEvaluation;
+MObject cvMeshBlur::aRelaxIterations;
+MObject cvMeshBlur::aRelaxStrength;
 const int cvMeshBlur::taskCount = 16;
 
 MStatus cvMeshBlur::initialize()
@@ -26,6 +35,12 @@ MStatus cvMeshBlur::initialize()
     addAttribute(aWorldMatrix);
     attributeAffects(aWorldMatrix, outputGeom);
 
+    // Per geometry world matrices, indexed like input, for nodes shared by several meshes
+    aGeometryWorldMatrix = mAttr.create("geometryWorldMatrix", "geometryWorldMatrix");
+    mAttr.setArray(true);
+    addAttribute(aGeometryWorldMatrix);
+    attributeAffects(aGeometryWorldMatrix, outputGeom);
+
     aStartFrame = nAttr.create("startFrame", "startFrame", MFnNumericData::kInt, 0, &status);
     nAttr.setKeyable(true);
     addAttribute(aStartFrame);
@@ -61,6 +76,40 @@ MStatus cvMeshBlur::initialize()
     addAttribute(aMaxSmearVelocity);
     attributeAffects(aMaxSmearVelocity, outputGeom);
 
+    aMaxCatchUpFrames = nAttr.create("maxCatchUpFrames", "maxCatchUpFrames", MFnNumericData::kInt, 10, &status);
+    nAttr.setMin(0);
+    nAttr.setKeyable(true);
+    addAttribute(aMaxCatchUpFrames);
+    attributeAffects(aMaxCatchUpFrames, outputGeom);
+
+    // Estimated offset error allowed when skipped frames are folded into one step. The
+    // estimate samples a middle and the last frame, so it is a heuristic rather than a bound.
+    aCatchUpTolerance = nAttr.create("catchUpTolerance", "catchUpTolerance", MFnNumericData::kDouble, 0.001, &status);
+    nAttr.setMin(0.0);
+    nAttr.setKeyable(true);
+    addAttribute(aCatchUpTolerance);
+    attributeAffects(aCatchUpTolerance, outputGeom);
+
+    aRelaxIterations = nAttr.create("relaxIterations", "relaxIterations", MFnNumericData::kInt, 0, &status);
+    nAttr.setMin(0);
+    nAttr.setSoftMax(20);
+    nAttr.setKeyable(true);
+    addAttribute(aRelaxIterations);
+    attributeAffects(aRelaxIterations, outputGeom);
+
+    aRelaxStrength = nAttr.create("relaxStrength", "relaxStrength", MFnNumericData::kFloat, 0.5, &status);
+    nAttr.setMin(0.0);
+    nAttr.setMax(1.0);
+    nAttr.setKeyable(true);
+    addAttribute(aRelaxStrength);
+    attributeAffects(aRelaxStrength, outputGeom);
+
+    // Off by default since hashing and keeping shared copies only pays off on duplicated setups
+    aShareEvaluation = nAttr.create("shareEvaluation", "shareEvaluation", MFnNumericData::kBoolean, false, &status);
+    nAttr.setKeyable(true);
+    addAttribute(aShareEvaluation);
+    attributeAffects(aShareEvaluation, outputGeom);
+
     MGlobal::executeCommand("makePaintable -attrType multiFloat -sm deformer cvMeshBlur weights");
 
     return MS::kSuccess;
@@ -69,7 +118,6 @@ MStatus cvMeshBlur::initialize()
 
 cvMeshBlur::cvMeshBlur()
 {
-	m_initialized = false;
 	MThreadPool::init();
 }
 
@@ -103,45 +151,60 @@ MStatus cvMeshBlur::deform(MDataBlock& data, MItGeometry& itGeo, const MMatrix&
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
 	MTime time = data.inputValue(aTime).asTime();
-	MMatrix matrix = data.inputValue(aWorldMatrix).asMatrix();
+	// Pull the world matrices so transform changes dirty this geometry
+	data.inputValue(aWorldMatrix).asMatrix();
+	MArrayDataHandle hGeometryWorldMatrix = data.inputArrayValue(aGeometryWorldMatrix);
+	if (hGeometryWorldMatrix.jumpToElement(geomIndex) == MS::kSuccess)
+	{
+		hGeometryWorldMatrix.inputValue().asMatrix();
+	}
 	int startFrame = data.inputValue(aStartFrame, &status).asInt();
 	double minSmearVelocity = data.inputValue(aMinSmearVelocity).asDouble();
 	double maxSmearVelocity = data.inputValue(aMaxSmearVelocity).asDouble();
 	int smearFrames = data.inputValue(aSmearFrames).asInt();
 	float normalOffset = data.inputValue(aNormalOffset, &status).asFloat();
 	float angleMagnitude = data.inputValue(aAngleMagnitude, &status).asFloat();
-
-	MPointArray previousGoal, current;
-	double difference = time.value() - m_previousTime.value();
-	if (!m_initialized)
+	int maxCatchUpFrames = data.inputValue(aMaxCatchUpFrames).asInt();
+	double catchUpTolerance = data.inputValue(aCatchUpTolerance).asDouble();
+	int relaxIterations = data.inputValue(aRelaxIterations).asInt();
+	float relaxStrength = data.inputValue(aRelaxStrength).asFloat();
+	bool shareEvaluation = data.inputValue(aShareEvaluation).asBool();
+
+	GeometryState& state = m_geometryState[geomIndex];
+	if (!state.history)
+	{
+		state.history = std::make_shared<SharedEvaluation>();
+	}
+	std::shared_ptr<SharedEvaluation> history = state.history;
+	double difference = time.value() - history->previousTime.value();
+
+	// Whole frame jumps forward are integrated in one pass instead of resetting
+	unsigned int catchUpFrames = 1;
+	if (difference > 1.0 &&
+		difference <= (double)maxCatchUpFrames &&
+		std::floor(difference) == difference)
 	{
-		m_previousTime = time;
+		catchUpFrames = (unsigned int)difference;
 	}
 
 	MPointArray goal;
 	itGeo.allPositions(goal);
-	if (!m_initialized ||
-		difference != 1.0 && difference != 0.0 ||
-		time.value() < (double)startFrame)
+	bool reset = !history->initialized ||
+		difference != 0.0 && catchUpFrames == 1 && difference != 1.0 ||
+		time.value() < (double)startFrame;
+	if (reset)
 	{
-		m_previousPositions.copy(goal);
-		// Put in world space
-		for (unsigned int i = 0; i < m_previousPositions.length(); i++)
-		{
-			m_previousPositions[i] *= localToWorldMatrix;
-		}
-		m_currentPositions.copy(m_previousPositions);
-		m_initialized = true;
+		catchUpFrames = 1;
 	}
 
-	// Get the painted weights and vertex normals
+	// Get the painted weights and the deformed vertex ids
 	MFloatArray weights(itGeo.count());
-	MVectorArray normals(itGeo.count());
+	state.localToMesh.resize(itGeo.count());
 	int i = 0;
 	for (itGeo.reset(); !itGeo.isDone(); itGeo.next(), i++)
 	{
 		weights[i] = weightValue(data, geomIndex, itGeo.index()) * env;
-		status = fnMesh.getVertexNormal(itGeo.index(), false, normals[i]);
+		state.localToMesh[i] = itGeo.index();
 	}
 
 	if (smearFrames < 1)
@@ -149,14 +212,95 @@ MStatus cvMeshBlur::deform(MDataBlock& data, MItGeometry& itGeo, const MMatrix&
 		smearFrames = 1;
 	}
 	double smearRate = 1.0 / (double)smearFrames;
+
+	std::shared_ptr<SharedEvaluation> next = history;
+	std::weak_ptr<SharedEvaluation> parent;
+	unsigned long long key = 0;
+	bool relax = relaxIterations > 0 && relaxStrength > 0.0f;
+	if (shareEvaluation || relax)
+	{
+		status = UpdateTopology(state, fnMesh);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+	}
+
+	if (shareEvaluation)
+	{
+		// Nodes with identical inputs and identical history share one evaluation
+		if (!reset)
+		{
+			parent = history;
+		}
+		unsigned long long previousKey = reset ? 0 : history->key;
+		double parameters[] = {
+			time.value(), smearRate, minSmearVelocity, maxSmearVelocity, catchUpTolerance,
+			(double)normalOffset, (double)angleMagnitude, (double)catchUpFrames,
+			(double)relaxIterations, (double)relaxStrength,
+			(double)fnMesh.numVertices(), (double)fnMesh.numFaceVertices() };
+		key = cvMeshBlurRegistry::Hash(cvMeshBlurRegistry::kHashSeed, &previousKey, sizeof(previousKey));
+		key = cvMeshBlurRegistry::Hash(key, parameters, sizeof(parameters));
+		key = cvMeshBlurRegistry::Hash(key, &state.topologyHash, sizeof(state.topologyHash));
+		key = cvMeshBlurRegistry::Hash(key, localToWorldMatrix.matrix, sizeof(localToWorldMatrix.matrix));
+		key = cvMeshBlurRegistry::Hash(key, weights);
+		key = cvMeshBlurRegistry::Hash(key, goal);
+
+		std::shared_ptr<SharedEvaluation> shared = cvMeshBlurRegistry::FindMatching(
+			key, parent, parameters, sizeof(parameters) / sizeof(double), state.topologyHash,
+			localToWorldMatrix, weights, goal);
+		if (shared)
+		{
+			state.history = shared;
+			return itGeo.setAllPositions(shared->deformedPointsLocal);
+		}
+
+		// Published evaluations are read only, so the new frame is written to a fresh one
+		next = std::make_shared<SharedEvaluation>();
+		next->parameters.assign(parameters, parameters + sizeof(parameters) / sizeof(double));
+		next->topologyHash = state.topologyHash;
+		next->matrix = localToWorldMatrix;
+		next->weights = weights;
+		next->inputPoints = goal;
+	}
+	else if (history->published)
+	{
+		next = std::make_shared<SharedEvaluation>();
+	}
+
+	// Unpublished history is only referenced by this node so it is advanced in place
+	MPointArray resetGoal, current;
+	MPointArray* pPreviousGoal = &history->previousPositions;
+	MPointArray* pCurrent = next == history ? &history->currentPositions : &current;
+	if (reset)
+	{
+		resetGoal.copy(goal);
+		// Put in world space
+		for (unsigned int j = 0; j < resetGoal.length(); j++)
+		{
+			resetGoal[j] *= localToWorldMatrix;
+		}
+		pCurrent->copy(resetGoal);
+		pPreviousGoal = &resetGoal;
+	}
+	else if (pCurrent == &current)
+	{
+		current = history->currentPositions;
+	}
+
+	// Get the vertex normals
+	MVectorArray normals(itGeo.count());
+	i = 0;
+	for (itGeo.reset(); !itGeo.isDone(); itGeo.next(), i++)
+	{
+		status = fnMesh.getVertexNormal(itGeo.index(), false, normals[i]);
+	}
+
 	unsigned int numVerts = goal.length();
 	MPointArray deformedPointsLocal(goal);
-	MPointArray deformedPointsWorld(m_currentPositions);
+	MPointArray deformedPointsWorld(*pCurrent);
 
 	m_taskData.numDeformVerts = numVerts;
 	m_taskData.pGoal = &goal;
-	m_taskData.pCurrent = &m_currentPositions;
-	m_taskData.pPreviousGoal = &m_previousPositions;
+	m_taskData.pCurrent = pCurrent;
+	m_taskData.pPreviousGoal = pPreviousGoal;
 	m_taskData.smearRate = smearRate;
 	m_taskData.minSmearVelocity = minSmearVelocity;
 	m_taskData.maxSmearVelocity = maxSmearVelocity;
@@ -168,22 +312,54 @@ MStatus cvMeshBlur::deform(MDataBlock& data, MItGeometry& itGeo, const MMatrix&
 	m_taskData.worldToLocalMatrix = worldToLocalMatrix;
 	m_taskData.normalOffset = normalOffset;
 	m_taskData.angleMagnitude = angleMagnitude;
+	m_taskData.catchUpFrames = catchUpFrames;
+	m_taskData.catchUpTolerance = catchUpTolerance;
+	state.active.assign(numVerts, 0);
+	m_taskData.pActive = &state.active;
 
 	CreateThreadData();
 	status = MThreadPool::newParallelRegion(CreateTasks, (void *)&m_threadData[0]);
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
+	if (relax)
+	{
+		status = BuildAdjacency(state, oInputGeom);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		for (int b = 0; b < 2; ++b)
+		{
+			state.relaxBuffers[b].x.resize(numVerts);
+			state.relaxBuffers[b].y.resize(numVerts);
+			state.relaxBuffers[b].z.resize(numVerts);
+		}
+		m_taskData.relaxIterations = relaxIterations;
+		m_taskData.relaxStrength = relaxStrength;
+		m_taskData.pAdjacencyOffsets = &state.adjacencyOffsets;
+		m_taskData.pAdjacency = &state.adjacency;
+		m_taskData.pRelaxSrc = &state.relaxBuffers[0];
+		m_taskData.pRelaxDst = &state.relaxBuffers[1];
+		status = MThreadPool::newParallelRegion(CreateRelaxTasks, (void *)&m_threadData[0]);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+	}
+
 	status = itGeo.setAllPositions(deformedPointsLocal);
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
+	next->initialized = true;
 	// Store previous for next calculation
-	m_previousPositions = goal;
-
+	next->previousPositions = goal;
 	// Store current for next calculation
-	m_currentPositions = deformedPointsWorld;
-
+	next->currentPositions = deformedPointsWorld;
 	// Store previous time
-	m_previousTime = time;
+	next->previousTime = time;
+	state.history = next;
+	if (shareEvaluation)
+	{
+		next->key = key;
+		next->parent = parent;
+		next->deformedPointsLocal = deformedPointsLocal;
+		next->published = true;
+		cvMeshBlurRegistry::Insert(next);
+	}
 
 	return status;
 }
@@ -228,6 +404,166 @@ void cvMeshBlur::CreateTasks(void* pData, MThreadRootTask* pRoot)
 	}
 }
 
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+Summary:
+	Advances the smear of a single vertex by one frame.
+
+Parameters:
+	[in]     goal          - World space goal position this frame.
+	[in]     previousGoal  - World space goal position last frame.
+	[in,out] current       - World space smeared position.
+	[out]    deformed      - World space output position.
+	[out]    offsetScale   - Factor the offset from the goal was scaled by.
+
+Returns:
+	true if the vertex is smeared, false if it sits on the goal.
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+static bool SmearStep(const MPoint& goal, const MPoint& previousGoal, MPoint& current,
+                      const MVector& normal, float weight, const TaskData& data,
+                      MPoint& deformed, double& offsetScale)
+{
+	MVector velocityUnit = (goal - current).normal();
+	double goalVelocity = (goal - previousGoal).length();
+	double dot, velocityDelta;
+
+	offsetScale = 1.0;
+	if (goalVelocity != 0.0)
+	{
+		velocityDelta = goalVelocity - data.minSmearVelocity;
+		if (velocityDelta > 0.0)
+		{
+			if (velocityDelta > data.maxSmearVelocity)
+			{
+				velocityDelta = data.maxSmearVelocity;
+			}
+			offsetScale = velocityDelta / goalVelocity;
+			current = goal + ((current - goal) * offsetScale);
+		}
+		else
+		{
+			// If there is no velocity delta, do not smear
+			offsetScale = 0.0;
+			current = goal;
+		}
+	}
+
+	dot = velocityUnit * normal;
+	if (weight == 0.0f || dot >= 0.0 || goalVelocity == 0.0)
+	{
+		// No need to calculate because the vertex is either
+		// 1) Painted 0
+		// 2) Facing the velocity vector
+		// 3) Not moving
+		deformed = goal;
+		return false;
+	}
+
+	current += (goal - current) * data.smearRate;
+
+	dot = -dot;
+	dot = (dot + data.normalOffset) * data.angleMagnitude;
+	if (dot > 1.0)
+	{
+		dot = 1.0;
+	}
+	// Scale offset by normal-velocity vector dot product
+	current = ((current - goal) * dot) + goal;
+	offsetScale *= (1.0 - data.smearRate) * dot;
+	deformed = current;
+	return true;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+Summary:
+	Offset from the goal after a number of frames of the catch-up series.
+
+	Each frame scales the offset by scale and subtracts the goal step, so after
+	frames steps the offset is scale^n * offset - step * (scale + ... + scale^n).
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+static MVector SeriesOffset(const MVector& offset, const MVector& step, double scale, unsigned int frames)
+{
+	double scaleN = std::pow(scale, (double)frames);
+	double series = std::fabs(1.0 - scale) < 1.0e-12 ?
+		(double)frames : scale * (1.0 - scaleN) / (1.0 - scale);
+	return offset * scaleN - step * series;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+Summary:
+	Advances the smear of a single vertex across several skipped frames,
+	assuming the goal moved along a straight line between the two evaluated
+	frames.
+
+	While the goal moves at a constant velocity each frame scales the offset
+	from the goal by the same factor, so the frames between the first and last
+	collapse into a geometric series. The first and last frames are stepped
+	exactly.
+
+	The factor changes with the dot term as the offset turns, so the error is
+	estimated by also stepping one middle frame exactly. The difference from
+	the series on that frame is charged to every middle frame, since the
+	factor never exceeds 1 and per-frame errors cannot grow. That is added to
+	the difference on the last frame. This is a heuristic, not a strict bound,
+	because only those two frames are sampled. If the estimate is above the
+	tolerance, every frame is stepped exactly instead.
+
+Returns:
+	true if the vertex is smeared, false if it sits on the goal.
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+static bool CatchUpStep(const MPoint& goal, const MPoint& previousGoal, MPoint& current,
+                        const MVector& normal, float weight, const TaskData& data,
+                        MPoint& deformed)
+{
+	unsigned int frames = data.catchUpFrames;
+	MVector step = (goal - previousGoal) / (double)frames;
+	double scale, sampleScale;
+	bool isActive;
+
+	// With two frames stepping exactly costs the same as the series
+	if (data.catchUpTolerance > 0.0 && frames > 2)
+	{
+		MPoint firstGoal = previousGoal + step;
+		MPoint position(current);
+		SmearStep(firstGoal, previousGoal, position, normal, weight, data, deformed, scale);
+		MVector firstOffset = position - firstGoal;
+		unsigned int middleFrames = frames - 2;
+		double error = 0.0;
+
+		if (middleFrames >= 2)
+		{
+			unsigned int sample = middleFrames / 2;
+			MPoint sampleGoal = firstGoal + step * (double)sample;
+			position = sampleGoal + SeriesOffset(firstOffset, step, scale, sample);
+			SmearStep(sampleGoal + step, sampleGoal, position, normal, weight, data, deformed, sampleScale);
+			MVector predicted = SeriesOffset(firstOffset, step, scale, sample + 1);
+			error += ((position - (sampleGoal + step)) - predicted).length() * (double)middleFrames;
+		}
+
+		MPoint lastGoal = goal - step;
+		MVector offset = SeriesOffset(firstOffset, step, scale, middleFrames);
+		position = lastGoal + offset;
+		MVector predicted = (offset - step) * scale;
+		isActive = SmearStep(goal, lastGoal, position, normal, weight, data, deformed, sampleScale);
+		error += ((position - goal) - predicted).length();
+		if (error <= data.catchUpTolerance)
+		{
+			current = position;
+			return isActive;
+		}
+	}
+
+	// Step every frame along the straight path between the goals
+	isActive = false;
+	MPoint frameGoal, framePreviousGoal(previousGoal);
+	for (unsigned int frame = 1; frame <= frames; frame++)
+	{
+		frameGoal = frame == frames ? goal : previousGoal + step * (double)frame;
+		isActive = SmearStep(frameGoal, framePreviousGoal, current, normal, weight, data, deformed, scale);
+		framePreviousGoal = frameGoal;
+	}
+	return isActive;
+}
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
 Summary:
 	Evaluation
@@ -238,10 +574,7 @@ Returns:
 MThreadRetVal cvMeshBlur::ThreadEvaluate(void *pParam)
 {
 	ThreadData* pThreadData = static_cast<ThreadData*>(pParam);
-    TaskData* pData = pThreadData->pData;
-    double smearRate = pData->smearRate;
-	double minSmearVelocity = pData->minSmearVelocity;
-	double maxSmearVelocity = pData->maxSmearVelocity;
+	TaskData* pData = pThreadData->pData;
 	MPointArray& currentPositions = (*(pData->pCurrent));
 	MPointArray& goal = (*(pData->pGoal));
 	MPointArray& previousGoal = (*(pData->pPreviousGoal));
@@ -251,13 +584,12 @@ MThreadRetVal cvMeshBlur::ThreadEvaluate(void *pParam)
 	MVectorArray& normals = *(pData->pNormals);
 	MMatrix& localToWorldMatrix = pData->localToWorldMatrix;
 	MMatrix& worldToLocalMatrix = pData->worldToLocalMatrix;
-	float normalOffset = pData->normalOffset;
-	float angleMagnitude = pData->angleMagnitude;
+	std::vector<unsigned char>& active = *(pData->pActive);
 
 	unsigned int taskStart = pThreadData->start;
 	unsigned int taskEnd = pThreadData->end;
-	double dot, goalVelocity, velocityDelta;
-	MVector velocity, velocityUnit;
+	double offsetScale;
+	bool isActive;
 
 	for (unsigned int i = taskStart; i < taskEnd; i++)
 	{
@@ -269,53 +601,312 @@ MThreadRetVal cvMeshBlur::ThreadEvaluate(void *pParam)
 		// Put input points into world space
 		goal[i] *= localToWorldMatrix;
 
-		velocity = (goal[i] - currentPositions[i]);
-		velocityUnit = velocity.normal();
-		goalVelocity = (goal[i] - previousGoal[i]).length();
+		if (pData->catchUpFrames > 1)
+		{
+			isActive = CatchUpStep(goal[i], previousGoal[i], currentPositions[i], normals[i],
+			                       weights[i], *pData, deformedPointsWorld[i]);
+		}
+		else
+		{
+			isActive = SmearStep(goal[i], previousGoal[i], currentPositions[i], normals[i],
+			                     weights[i], *pData, deformedPointsWorld[i], offsetScale);
+		}
+		if (!isActive)
+		{
+			continue;
+		}
+
+		deformedPointsLocal[i] = currentPositions[i] * worldToLocalMatrix;
+		deformedPointsLocal[i] = ptOrig + ((deformedPointsLocal[i] - ptOrig) * weights[i]);
+		active[i] = 1;
+	}
+	return 0;
+}
+
+MStatus cvMeshBlur::connectionMade(const MPlug& plug, const MPlug& otherPlug, bool asSrc)
+{
+	if (!asSrc && (plug.attribute() == inputGeom || plug.attribute() == input))
+	{
+		for (auto& entry : m_geometryState)
+		{
+			entry.second.topologyDirty = true;
+		}
+	}
+	return MPxDeformerNode::connectionMade(plug, otherPlug, asSrc);
+}
+
+MStatus cvMeshBlur::connectionBroken(const MPlug& plug, const MPlug& otherPlug, bool asSrc)
+{
+	if (!asSrc && (plug.attribute() == inputGeom || plug.attribute() == input))
+	{
+		for (auto& entry : m_geometryState)
+		{
+			entry.second.topologyDirty = true;
+		}
+	}
+	return MPxDeformerNode::connectionBroken(plug, otherPlug, asSrc);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+Summary:
+	Updates the topology hash of a geometry from its face-vertex lists and the
+	deformed vertex ids in state.localToMesh. The face-vertex lists are only
+	read and rehashed when the vertex, face-vertex, polygon or edge counts
+	change, or when the input geometry was reconnected. A count preserving
+	edit such as an edge spin on the same upstream connection is not detected
+	until one of those happens.
+
+Returns:
+	MStatus
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+MStatus cvMeshBlur::UpdateTopology(GeometryState& state, MFnMesh& fnMesh)
+{
+	MStatus status;
+	int counts[4] = { fnMesh.numVertices(), fnMesh.numFaceVertices(), fnMesh.numPolygons(), fnMesh.numEdges() };
+	if (state.topologyDirty ||
+		!std::equal(counts, counts + 4, state.topologyCounts))
+	{
+		status = fnMesh.getVertices(state.polygonCounts, state.polygonVertices);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		unsigned int polygonCount = state.polygonCounts.length();
+		state.faceVertexIds.resize(polygonCount + state.polygonVertices.length());
+		if (!state.faceVertexIds.empty())
+		{
+			state.polygonCounts.get(state.faceVertexIds.data());
+			state.polygonVertices.get(state.faceVertexIds.data() + polygonCount);
+		}
+		state.faceHash = cvMeshBlurRegistry::Hash(cvMeshBlurRegistry::kHashSeed, state.faceVertexIds.data(),
+		                                          state.faceVertexIds.size() * sizeof(int));
+		std::copy(counts, counts + 4, state.topologyCounts);
+		state.topologyDirty = false;
+	}
+	state.topologyHash = cvMeshBlurRegistry::Hash(state.faceHash, state.localToMesh.data(),
+	                                              state.localToMesh.size() * sizeof(int));
+	return MS::kSuccess;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+Summary:
+	Builds the CSR vertex adjacency used by the relaxation pass. Indices are
+	in geometry iterator order and only neighbors that are also deformed are
+	stored. The cache is reused while the topology hash from UpdateTopology
+	is unchanged.
+
+Returns:
+	MStatus
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+MStatus cvMeshBlur::BuildAdjacency(GeometryState& state, MObject& oMesh)
+{
+	MStatus status;
+	if (!state.adjacencyOffsets.empty() &&
+		state.topologyHash == state.adjacencyTopologyHash)
+	{
+		return MS::kSuccess;
+	}
+
+	MFnMesh fnMesh(oMesh, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	unsigned int numVerts = (unsigned int)state.localToMesh.size();
+	int meshVertexCount = fnMesh.numVertices();
+
+	// Map mesh vertex ids to iterator order
+	state.meshToLocal.assign(meshVertexCount, -1);
+	unsigned int i;
+	for (i = 0; i < numVerts; i++)
+	{
+		int index = state.localToMesh[i];
+		if (index >= 0 && index < meshVertexCount)
+		{
+			state.meshToLocal[index] = (int)i;
+		}
+	}
+
+	state.adjacencyOffsets.assign(numVerts + 1, 0);
+	state.adjacency.clear();
+	state.adjacency.reserve(state.polygonVertices.length());
 
-		if (goalVelocity != 0.0)
+	MItMeshVertex itVert(oMesh, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	MIntArray connected;
+	int prevIndex;
+	for (i = 0; i < numVerts; i++)
+	{
+		state.adjacencyOffsets[i] = (unsigned int)state.adjacency.size();
+		int index = state.localToMesh[i];
+		if (index < 0 || index >= meshVertexCount)
+		{
+			continue;
+		}
+		status = itVert.setIndex(index, prevIndex);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		itVert.getConnectedVertices(connected);
+		for (unsigned int j = 0; j < connected.length(); j++)
 		{
-			velocityDelta = goalVelocity - minSmearVelocity;
-			if (velocityDelta > 0.0)
+			int neighbor = state.meshToLocal[connected[j]];
+			if (neighbor >= 0)
 			{
-				if (velocityDelta > maxSmearVelocity)
-				{
-					velocityDelta = maxSmearVelocity;
-				}
-				currentPositions[i] = goal[i] + ((currentPositions[i] - goal[i]) * (velocityDelta / goalVelocity));
+				state.adjacency.push_back((unsigned int)neighbor);
 			}
-			else
+		}
+	}
+	state.adjacencyOffsets[numVerts] = (unsigned int)state.adjacency.size();
+
+	state.adjacencyTopologyHash = state.topologyHash;
+	return MS::kSuccess;
+}
+
+void cvMeshBlur::CreateRelaxTasks(void* pData, MThreadRootTask* pRoot)
+{
+	ThreadData* pThreadData = static_cast<ThreadData*>(pData);
+
+	if (pThreadData)
+	{
+		TaskData* pTaskData = pThreadData[0].pData;
+		int taskCount = pThreadData[0].numTasks;
+		for (int i = 0; i < taskCount; ++i)
+		{
+			MThreadPool::createTask(RelaxGather, (void *)&pThreadData[i], pRoot);
+		}
+		MThreadPool::executeAndJoin(pRoot);
+
+		// Jacobi iterations need every chunk to finish before the buffers swap
+		for (int iteration = 0; iteration < pTaskData->relaxIterations; ++iteration)
+		{
+			for (int i = 0; i < taskCount; ++i)
 			{
-				// If there is no velocity delta, do not smear
-				currentPositions[i] = goal[i];
+				MThreadPool::createTask(RelaxIterate, (void *)&pThreadData[i], pRoot);
 			}
+			MThreadPool::executeAndJoin(pRoot);
+			std::swap(pTaskData->pRelaxSrc, pTaskData->pRelaxDst);
 		}
 
-		dot = velocityUnit * normals[i];
-		if (weights[i] == 0.0f || dot >= 0.0 || goalVelocity == 0.0)
+		for (int i = 0; i < taskCount; ++i)
 		{
-			// No need to calculate because the vertex is either
-			// 1) Painted 0
-			// 2) Facing the velocity vector
-			// 3) Not moving
-			deformedPointsWorld[i] = goal[i];
-			continue;
+			MThreadPool::createTask(RelaxApply, (void *)&pThreadData[i], pRoot);
 		}
+		MThreadPool::executeAndJoin(pRoot);
+	}
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+Summary:
+	Extracts the world space smear offsets of the active vertices into the
+	relaxation source buffer. Inactive vertices get a zero offset.
 
-		currentPositions[i] += (goal[i] - currentPositions[i]) * smearRate;
+Returns:
+	0
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+MThreadRetVal cvMeshBlur::RelaxGather(void *pParam)
+{
+	ThreadData* pThreadData = static_cast<ThreadData*>(pParam);
+	TaskData* pData = pThreadData->pData;
+	MPointArray& goal = (*(pData->pGoal));
+	MPointArray& deformedPointsWorld = (*(pData->pDeformedPointsWorld));
+	const std::vector<unsigned char>& active = *(pData->pActive);
+	double* x = pData->pRelaxSrc->x.data();
+	double* y = pData->pRelaxSrc->y.data();
+	double* z = pData->pRelaxSrc->z.data();
 
-		dot = -dot;
-		dot = (dot + normalOffset) * angleMagnitude;
-		if (dot > 1.0)
+	unsigned int taskEnd = pThreadData->end;
+	for (unsigned int i = pThreadData->start; i < taskEnd; i++)
+	{
+		if (active[i])
+		{
+			x[i] = deformedPointsWorld[i].x - goal[i].x;
+			y[i] = deformedPointsWorld[i].y - goal[i].y;
+			z[i] = deformedPointsWorld[i].z - goal[i].z;
+		}
+		else
 		{
-			dot = 1.0;
+			x[i] = 0.0;
+			y[i] = 0.0;
+			z[i] = 0.0;
 		}
-		// Scale offset by normal-velocity vector dot product
-		currentPositions[i] = ((currentPositions[i] - goal[i]) * dot) + goal[i];
-		deformedPointsWorld[i] = currentPositions[i];
+	}
+	return 0;
+}
 
-		deformedPointsLocal[i] = currentPositions[i] * worldToLocalMatrix;
-		deformedPointsLocal[i] = ptOrig + ((deformedPointsLocal[i] - ptOrig) * weights[i]);
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+Summary:
+	One Jacobi Laplacian step over the smear offsets. Reads the source buffer
+	and writes the destination buffer so chunks can run in any order.
+
+Returns:
+	0
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+MThreadRetVal cvMeshBlur::RelaxIterate(void *pParam)
+{
+	ThreadData* pThreadData = static_cast<ThreadData*>(pParam);
+	TaskData* pData = pThreadData->pData;
+	const unsigned char* active = pData->pActive->data();
+	const unsigned int* offsets = pData->pAdjacencyOffsets->data();
+	const unsigned int* adjacency = pData->pAdjacency->data();
+	const double* srcX = pData->pRelaxSrc->x.data();
+	const double* srcY = pData->pRelaxSrc->y.data();
+	const double* srcZ = pData->pRelaxSrc->z.data();
+	double* dstX = pData->pRelaxDst->x.data();
+	double* dstY = pData->pRelaxDst->y.data();
+	double* dstZ = pData->pRelaxDst->z.data();
+	double strength = pData->relaxStrength;
+
+	unsigned int taskEnd = pThreadData->end;
+	for (unsigned int i = pThreadData->start; i < taskEnd; i++)
+	{
+		unsigned int begin = offsets[i];
+		unsigned int end = offsets[i + 1];
+		if (!active[i] || begin == end)
+		{
+			dstX[i] = srcX[i];
+			dstY[i] = srcY[i];
+			dstZ[i] = srcZ[i];
+			continue;
+		}
+		double sumX = 0.0, sumY = 0.0, sumZ = 0.0;
+		for (unsigned int j = begin; j < end; j++)
+		{
+			unsigned int n = adjacency[j];
+			sumX += srcX[n];
+			sumY += srcY[n];
+			sumZ += srcZ[n];
+		}
+		double scale = strength / (double)(end - begin);
+		dstX[i] = srcX[i] + (sumX * scale - srcX[i] * strength);
+		dstY[i] = srcY[i] + (sumY * scale - srcY[i] * strength);
+		dstZ[i] = srcZ[i] + (sumZ * scale - srcZ[i] * strength);
+	}
+	return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+Summary:
+	Writes the relaxed offsets of the active vertices back to the local
+	output points. The world space smear history is left unrelaxed so the
+	relaxation does not accumulate from frame to frame.
+
+Returns:
+	0
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+MThreadRetVal cvMeshBlur::RelaxApply(void *pParam)
+{
+	ThreadData* pThreadData = static_cast<ThreadData*>(pParam);
+	TaskData* pData = pThreadData->pData;
+	MPointArray& goal = (*(pData->pGoal));
+	MPointArray& deformedPointsLocal = (*(pData->pDeformedPointsLocal));
+	MFloatArray& weights = *(pData->pWeights);
+	const std::vector<unsigned char>& active = *(pData->pActive);
+	MMatrix& worldToLocalMatrix = pData->worldToLocalMatrix;
+	const RelaxBuffer& offsets = *(pData->pRelaxSrc);
+
+	unsigned int taskEnd = pThreadData->end;
+	for (unsigned int i = pThreadData->start; i < taskEnd; i++)
+	{
+		if (!active[i])
+		{
+			continue;
+		}
+		MPoint ptOrig = goal[i] * worldToLocalMatrix;
+		MVector offset = MVector(offsets.x[i], offsets.y[i], offsets.z[i]) * worldToLocalMatrix;
+		deformedPointsLocal[i] = ptOrig + (offset * weights[i]);
 	}
 	return 0;
 }
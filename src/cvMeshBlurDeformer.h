@@ -22,6 +22,7 @@
 #include <maya/MVectorArray.h>
 
 #include <maya/MItGeometry.h>
+#include <maya/MItMeshVertex.h>
 
 #include <maya/MPxDeformerNode.h>
 #include <maya/MFnEnumAttribute.h>
@@ -40,7 +41,55 @@
 #include <maya/MFnNurbsCurve.h>
 #include <maya/MFnSubd.h>
 #include <maya/MFnData.h>
+
+#include "cvMeshBlurRegistry.h"
+
 #include <array>
+#include <map>
+#include <utility>
+#include <vector>
+
+/** Structure-of-arrays offset buffer used by the smear relaxation pass. */
+struct RelaxBuffer
+{
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> z;
+};
+
+/** Smear history and caches kept for each deformed geometry. The history may be shared. */
+struct GeometryState
+{
+    GeometryState()
+        : topologyDirty(true),
+          faceHash(0),
+          topologyHash(0),
+          adjacencyTopologyHash(0)
+    {
+        topologyCounts[0] = topologyCounts[1] = topologyCounts[2] = topologyCounts[3] = -1;
+    }
+
+    std::shared_ptr<SharedEvaluation> history;
+
+    // Connectivity and membership, rehashed only when the counts change or the
+    // input geometry is reconnected
+    std::vector<int> localToMesh;  /**< Mesh vertex id of each deformed vertex. */
+    std::vector<int> faceVertexIds;
+    MIntArray polygonCounts;
+    MIntArray polygonVertices;
+    bool topologyDirty;
+    int topologyCounts[4];
+    unsigned long long faceHash;
+    unsigned long long topologyHash;  /**< Face-vertex lists combined with localToMesh. */
+
+    // Cached CSR vertex adjacency, indexed by geometry iterator order
+    std::vector<unsigned int> adjacencyOffsets;
+    std::vector<unsigned int> adjacency;
+    std::vector<int> meshToLocal;
+    unsigned long long adjacencyTopologyHash;
+    std::vector<unsigned char> active;
+    RelaxBuffer relaxBuffers[2];
+};
 
 struct TaskData
 {
@@ -60,6 +109,18 @@ struct TaskData
     MMatrix localToWorldMatrix;
     MMatrix worldToLocalMatrix;
 
+    // Catch-up
+    unsigned int catchUpFrames;
+    double catchUpTolerance;
+
+    // Relaxation
+    int relaxIterations;
+    float relaxStrength;
+    std::vector<unsigned char>* pActive;
+    const std::vector<unsigned int>* pAdjacencyOffsets;
+    const std::vector<unsigned int>* pAdjacency;
+    RelaxBuffer* pRelaxSrc;
+    RelaxBuffer* pRelaxDst;
 };
 
 struct ThreadData
@@ -78,12 +139,18 @@ public:
 
     virtual MStatus deform(MDataBlock& data, MItGeometry& iter, const MMatrix& mat,
                            unsigned int mIndex);
+    virtual MStatus connectionMade(const MPlug& plug, const MPlug& otherPlug, bool asSrc);
+    virtual MStatus connectionBroken(const MPlug& plug, const MPlug& otherPlug, bool asSrc);
 
     static  void* creator();
     static  MStatus initialize();
     void CreateThreadData();
     static void CreateTasks(void *data, MThreadRootTask *pRoot);
     static MThreadRetVal ThreadEvaluate(void *pParam);
+    static void CreateRelaxTasks(void *data, MThreadRootTask *pRoot);
+    static MThreadRetVal RelaxGather(void *pParam);
+    static MThreadRetVal RelaxIterate(void *pParam);
+    static MThreadRetVal RelaxApply(void *pParam);
 
 public:
 
@@ -94,15 +161,21 @@ public:
     static MObject aMinSmearVelocity;
     static MObject aMaxSmearVelocity;
     static MObject aWorldMatrix;
+    static MObject aGeometryWorldMatrix;
     static MObject aSmearFrames;
     static MObject aNormalOffset;
     static MObject aAngleMagnitude;
+    static MObject aMaxCatchUpFrames;
+    static MObject aCatchUpTolerance;
+    static MObject aShareEvaluation;
+    static MObject aRelaxIterations;
+    static MObject aRelaxStrength;
 
 private:
-    bool m_initialized;
-    MPointArray m_previousPositions;
-    MPointArray m_currentPositions;
-    MTime m_previousTime;
+    static MStatus UpdateTopology(GeometryState& state, MFnMesh& fnMesh);
+    static MStatus BuildAdjacency(GeometryState& state, MObject& oMesh);
+
+    std::map<unsigned int, GeometryState> m_geometryState;
     TaskData m_taskData;
     std::array<ThreadData, 16> m_threadData;
 
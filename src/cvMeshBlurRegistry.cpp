@@ -0,0 +1,195 @@
+#include "cvMeshBlurRegistry.h"
+
+#include <algorithm>
+#include <cstring>
+
+const unsigned long long cvMeshBlurRegistry::kHashSeed = 14695981039346656037ULL;
+std::mutex cvMeshBlurRegistry::s_mutex;
+std::unordered_map<unsigned long long, std::weak_ptr<SharedEvaluation>> cvMeshBlurRegistry::s_evaluations;
+size_t cvMeshBlurRegistry::s_pruneSize = 64;
+unsigned long long cvMeshBlurRegistry::s_hits = 0;
+unsigned long long cvMeshBlurRegistry::s_lookups = 0;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+Summary:
+    Compares the stored inputs of a published evaluation with new inputs.
+Returns:
+    true if the evaluation was computed from exactly these inputs.
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+bool SharedEvaluation::Matches(const std::weak_ptr<SharedEvaluation>& parent, const double* parameters,
+                               size_t parameterCount, unsigned long long topologyHash, const MMatrix& matrix,
+                               const MFloatArray& weights, const MPointArray& points) const
+{
+    // Weak pointers compare by control block, so an expired history is never
+    // mistaken for a new one at the same address.
+    if (this->parent.owner_before(parent) || parent.owner_before(this->parent)) {
+        return false;
+    }
+    if (this->parameters.size() != parameterCount ||
+        !std::equal(this->parameters.begin(), this->parameters.end(), parameters)) {
+        return false;
+    }
+    // Identical points on different connectivity or vertex membership relax differently
+    if (this->topologyHash != topologyHash) {
+        return false;
+    }
+    if (!(this->matrix == matrix)) {
+        return false;
+    }
+    unsigned int count = weights.length();
+    if (this->weights.length() != count) {
+        return false;
+    }
+    for (unsigned int i = 0; i < count; ++i) {
+        if (this->weights[i] != weights[i]) {
+            return false;
+        }
+    }
+    count = points.length();
+    if (inputPoints.length() != count || deformedPointsLocal.length() != count) {
+        return false;
+    }
+    for (unsigned int i = 0; i < count; ++i) {
+        const MPoint& a = inputPoints[i];
+        const MPoint& b = points[i];
+        if (a.x != b.x || a.y != b.y || a.z != b.z) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline unsigned long long MixWord(unsigned long long hash, unsigned long long word)
+{
+    hash ^= word;
+    hash *= 1099511628211ULL;
+    return hash ^ (hash >> 32);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+Summary:
+    Folds a block of memory into a 64-bit hash, 8 bytes at a time.
+Parameters:
+    [in]    hash    - Running hash. Start with kHashSeed.
+    [in]    data    - Bytes to hash.
+    [in]    size    - Number of bytes.
+Returns:
+    The updated hash.
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+unsigned long long cvMeshBlurRegistry::Hash(unsigned long long hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    unsigned long long word;
+    size_t i = 0;
+    for (; i + sizeof(word) <= size; i += sizeof(word)) {
+        std::memcpy(&word, bytes + i, sizeof(word));
+        hash = MixWord(hash, word);
+    }
+    if (i < size) {
+        word = 0;
+        std::memcpy(&word, bytes + i, size - i);
+        hash = MixWord(hash, word);
+    }
+    return MixWord(hash, size);
+}
+
+unsigned long long cvMeshBlurRegistry::Hash(unsigned long long hash, const MPointArray& points)
+{
+    unsigned int count = points.length();
+    unsigned long long word;
+    hash = MixWord(hash, count);
+    for (unsigned int i = 0; i < count; ++i) {
+        const MPoint& pt = points[i];
+        std::memcpy(&word, &pt.x, sizeof(word));
+        hash = MixWord(hash, word);
+        std::memcpy(&word, &pt.y, sizeof(word));
+        hash = MixWord(hash, word);
+        std::memcpy(&word, &pt.z, sizeof(word));
+        hash = MixWord(hash, word);
+    }
+    return hash;
+}
+
+unsigned long long cvMeshBlurRegistry::Hash(unsigned long long hash, const MFloatArray& values)
+{
+    std::vector<float> buffer(values.length());
+    if (!buffer.empty()) {
+        values.get(buffer.data());
+    }
+    return Hash(hash, buffer.data(), buffer.size() * sizeof(float));
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+Summary:
+    Looks up the evaluation stored under key and returns it only if it was
+    computed from exactly the given inputs. Only verified matches count as hits.
+Returns:
+    The matching evaluation or an empty pointer.
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+std::shared_ptr<SharedEvaluation> cvMeshBlurRegistry::FindMatching(
+    unsigned long long key, const std::weak_ptr<SharedEvaluation>& parent, const double* parameters,
+    size_t parameterCount, unsigned long long topologyHash, const MMatrix& matrix,
+    const MFloatArray& weights, const MPointArray& points)
+{
+    std::shared_ptr<SharedEvaluation> evaluation;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        ++s_lookups;
+        auto it = s_evaluations.find(key);
+        if (it == s_evaluations.end()) {
+            return evaluation;
+        }
+        evaluation = it->second.lock();
+        if (!evaluation) {
+            s_evaluations.erase(it);
+            return evaluation;
+        }
+    }
+
+    // Published entries are read only, so they can be compared outside the lock.
+    if (!evaluation->Matches(parent, parameters, parameterCount, topologyHash, matrix, weights, points)) {
+        return std::shared_ptr<SharedEvaluation>();
+    }
+    std::lock_guard<std::mutex> lock(s_mutex);
+    ++s_hits;
+    return evaluation;
+}
+
+void cvMeshBlurRegistry::Insert(const std::shared_ptr<SharedEvaluation>& evaluation)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_evaluations[evaluation->key] = evaluation;
+
+    // Entries are only weakly held, so sweep out the ones no node references anymore.
+    if (s_evaluations.size() > s_pruneSize) {
+        for (auto it = s_evaluations.begin(); it != s_evaluations.end();) {
+            if (it->second.expired()) {
+                it = s_evaluations.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        s_pruneSize = s_evaluations.size() * 2 > 64 ? s_evaluations.size() * 2 : 64;
+    }
+}
+
+void cvMeshBlurRegistry::Clear()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_evaluations.clear();
+    s_pruneSize = 64;
+}
+
+void cvMeshBlurRegistry::GetStats(unsigned long long& hits, unsigned long long& lookups)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    hits = s_hits;
+    lookups = s_lookups;
+}
+
+void cvMeshBlurRegistry::ResetStats()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_hits = 0;
+    s_lookups = 0;
+}
@@ -0,0 +1,85 @@
+#ifndef CVMESHBLURREGISTRY_H
+#define CVMESHBLURREGISTRY_H
+
+#include <maya/MFloatArray.h>
+#include <maya/MMatrix.h>
+#include <maya/MPointArray.h>
+#include <maya/MTime.h>
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+  One evaluated frame of a cvMeshBlur geometry: the smear history needed to evaluate the
+  next frame. Published entries also keep their inputs and output points. Entries are never
+  modified once they are published, so nodes that share one only copy it when they advance
+  to a new frame.
+*/
+struct SharedEvaluation
+{
+    SharedEvaluation()
+        : key(0),
+          initialized(false),
+          published(false),
+          topologyHash(0)
+    {
+    }
+
+    bool Matches(const std::weak_ptr<SharedEvaluation>& parent, const double* parameters,
+                 size_t parameterCount, unsigned long long topologyHash, const MMatrix& matrix,
+                 const MFloatArray& weights, const MPointArray& points) const;
+
+    unsigned long long key;  /**< Content hash this evaluation was computed from. */
+    bool initialized;
+    bool published;  /**< Whether the entry is in the registry and so read only. */
+    MPointArray previousPositions;
+    MPointArray currentPositions;
+    MTime previousTime;
+
+    // Inputs and output of published entries
+    std::weak_ptr<SharedEvaluation> parent;  /**< History this frame was computed from. */
+    std::vector<double> parameters;
+    unsigned long long topologyHash;  /**< Hash of the face-vertex lists and deformed vertex ids. */
+    MMatrix matrix;
+    MFloatArray weights;
+    MPointArray inputPoints;
+    MPointArray deformedPointsLocal;
+};
+
+/**
+  Process-wide registry of evaluations keyed by a hash of the deformer inputs and the
+  key of the history they were computed from. Nodes whose upstream geometry, topology, matrix,
+  time and attributes are identical find each other here and share one result.
+  A key match is only a candidate; the stored inputs are compared before an entry is used.
+*/
+class cvMeshBlurRegistry
+{
+public:
+    static const unsigned long long kHashSeed;
+
+    static unsigned long long Hash(unsigned long long hash, const void* data, size_t size);
+    static unsigned long long Hash(unsigned long long hash, const MPointArray& points);
+    static unsigned long long Hash(unsigned long long hash, const MFloatArray& values);
+
+    static std::shared_ptr<SharedEvaluation> FindMatching(
+        unsigned long long key, const std::weak_ptr<SharedEvaluation>& parent, const double* parameters,
+        size_t parameterCount, unsigned long long topologyHash, const MMatrix& matrix,
+        const MFloatArray& weights, const MPointArray& points);
+    static void Insert(const std::shared_ptr<SharedEvaluation>& evaluation);
+    static void Clear();
+
+    static void GetStats(unsigned long long& hits, unsigned long long& lookups);
+    static void ResetStats();
+
+private:
+    static std::mutex s_mutex;
+    static std::unordered_map<unsigned long long, std::weak_ptr<SharedEvaluation>> s_evaluations;
+    static size_t s_pruneSize;
+    static unsigned long long s_hits;
+    static unsigned long long s_lookups;
+};
+
+#endif
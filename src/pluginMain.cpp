@@ -1,6 +1,7 @@
 
 #include "cvMeshBlurCmd.h"
 #include "cvMeshBlurDeformer.h"
+#include "cvMeshBlurRegistry.h"
 #include <maya/MFnPlugin.h>
 
 MStatus initializePlugin(MObject obj)
@@ -8,6 +9,7 @@ MStatus initializePlugin(MObject obj)
     MStatus status;
 
     MFnPlugin plugin(obj, "Chad Vernon", "1.0", "any");
+    cvMeshBlurRegistry::ResetStats();
 
     status = plugin.registerNode("cvMeshBlur", cvMeshBlur::id, cvMeshBlur::creator, cvMeshBlur::initialize, MPxNode::kDeformerNode);
     CHECK_MSTATUS_AND_RETURN_IT(status);
@@ -26,6 +28,8 @@ MStatus uninitializePlugin(MObject obj)
     CHECK_MSTATUS_AND_RETURN_IT(status);
     status = plugin.deregisterNode(cvMeshBlur::id);
     CHECK_MSTATUS_AND_RETURN_IT(status);
+    cvMeshBlurRegistry::Clear();
+    cvMeshBlurRegistry::ResetStats();
 
     return status;
 }